@@ -0,0 +1,46 @@
+//fragment
+#version 450 core
+
+uniform sampler2D u_TraceColorUnit;
+// x = samples, y = mean luminance, z = sum of squared differences from the mean
+uniform sampler2D u_TraceSumsUnit;
+uniform sampler2D u_HistoryColorUnit;
+// x = mean luminance, y = sum of squared differences from the mean, z = samples, w = variance of the mean
+uniform sampler2D u_HistoryMomentsUnit;
+uniform bool u_Reset = false;
+
+layout(location = 0) out vec4 color;
+layout(location = 1) out vec4 moments;
+
+void main()
+{
+  ivec2 pixel = ivec2(gl_FragCoord.xy);
+  vec4 newColor = texelFetch(u_TraceColorUnit, pixel, 0);
+  vec4 newStats = texelFetch(u_TraceSumsUnit, pixel, 0);
+  // The old color is kept after a reset until the pixel is traced again
+  color = texelFetch(u_HistoryColorUnit, pixel, 0);
+  moments = u_Reset ? vec4(0) : texelFetch(u_HistoryMomentsUnit, pixel, 0);
+
+  if(newStats.x > 0)
+  {
+    // Chan et al.'s parallel form of Welford's update, merging the new samples into the history
+    float oldSamples = moments.z;
+    float samples = oldSamples + newStats.x;
+    float delta = newStats.y - moments.x;
+    color = mix(color, newColor, newStats.x / samples);
+    moments.x += delta * newStats.x / samples;
+    moments.y += newStats.z + delta * delta * oldSamples * newStats.x / samples;
+    moments.z = samples;
+    moments.w = samples > 1 ? moments.y / ((samples - 1) * samples) : 0.0;
+  }
+}
+
+//vertex
+#version 450 core
+
+layout(location = 0) in vec2 a_Position;
+
+void main()
+{
+  gl_Position = vec4(a_Position, 0.0, 1.0);
+}
@@ -0,0 +1,36 @@
+//fragment
+#version 450 core
+
+uniform usampler2DArray u_StatsUnit;
+uniform int u_Layer;
+uniform float u_MaxValue = 1.0;
+
+in vec2 texCoord;
+
+out vec4 color;
+
+// Blue -> cyan -> green -> yellow -> red
+vec3 HeatColor(float value)
+{
+  value = clamp(value, 0.0, 1.0) * 4.0;
+  return clamp(vec3(value - 2.0, value < 2.0 ? value : 4.0 - value, 2.0 - value), 0.0, 1.0);
+}
+
+void main()
+{
+  uint value = texture(u_StatsUnit, vec3(texCoord, u_Layer)).r;
+  color = vec4(HeatColor(value / u_MaxValue), 1.0);
+}
+
+//vertex
+#version 450 core
+
+layout(location = 0) in vec2 a_Position;
+
+out vec2 texCoord;
+
+void main()
+{
+  gl_Position = vec4(a_Position, 0.0, 1.0);
+  texCoord = (a_Position + 1.0) * 0.5;
+}
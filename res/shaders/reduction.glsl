@@ -0,0 +1,54 @@
+//fragment
+#version 450 core
+
+// The luminance moments in the first pass, partial sums in the following ones
+uniform sampler2D u_InputUnit;
+uniform int u_InputWidth;
+uniform int u_InputHeight;
+uniform bool u_Classify = false;
+
+uniform int u_MinSamples = 4;
+uniform float u_ConvergenceThreshold = 1e-5;
+uniform bool u_Reset = false;
+
+// x = summed error of the active pixels, y = active pixels, z = pixels still warming up
+layout(location = 0) out vec4 sum;
+
+// Needs to match the classification in sampling.glsl
+vec4 Classify(vec4 moments)
+{
+  if(u_Reset || moments.z < u_MinSamples)
+    return vec4(0, 0, 1, 0);
+  if(moments.w < u_ConvergenceThreshold)
+    return vec4(0);
+  return vec4(moments.w, 1, 0, 0);
+}
+
+void main()
+{
+  // Each output texel sums up to 2x2 input texels, texels outside of odd sizes are skipped
+  ivec2 base = ivec2(gl_FragCoord.xy) * 2;
+  sum = vec4(0);
+  for(int y = 0; y < 2; y++)
+  {
+    for(int x = 0; x < 2; x++)
+    {
+      ivec2 pixel = base + ivec2(x, y);
+      if(pixel.x < u_InputWidth && pixel.y < u_InputHeight)
+      {
+        vec4 value = texelFetch(u_InputUnit, pixel, 0);
+        sum += u_Classify ? Classify(value) : value;
+      }
+    }
+  }
+}
+
+//vertex
+#version 450 core
+
+layout(location = 0) in vec2 a_Position;
+
+void main()
+{
+  gl_Position = vec4(a_Position, 0.0, 1.0);
+}
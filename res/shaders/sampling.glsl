@@ -0,0 +1,104 @@
+//fragment
+#version 450 core
+
+// x = mean luminance, y = sum of squared differences from the mean, z = samples, w = variance of the mean
+uniform sampler2D u_MomentsUnit;
+// Output of reduction.glsl
+uniform sampler2D u_SumUnit;
+
+uniform float u_RayBudget = 1.0; // Average amount of rays per pixel
+uniform int u_MaxSamples = 8;
+uniform int u_MinSamples = 4;
+uniform float u_ConvergenceThreshold = 1e-5;
+uniform bool u_Reset = false;
+uniform float u_Time;
+
+// x = samples to trace this frame
+layout(location = 0) out float samples;
+
+// ------------------ RANDOMIZATION CODE BEGIN ------------------------------
+
+// A single iteration of Bob Jenkins' One-At-A-Time hashing algorithm.
+uint Hash(uint x) 
+{
+  x += ( x << 10u );
+  x ^= ( x >>  6u );
+  x += ( x <<  3u );
+  x ^= ( x >> 11u );
+  x += ( x << 15u );
+  return x;
+}
+
+uint Hash(uvec4 v) 
+{ 
+  return Hash(v.x ^ Hash(v.y) ^ Hash(v.z) ^ Hash(v.w));
+}
+
+// Construct a float with half-open range [0:1] using low 23 bits.
+float FloatConstruct( uint m ) 
+{
+  const uint ieeeMantissa = 0x007FFFFFu; // binary32 mantissa bitmask
+  const uint ieeeOne      = 0x3F800000u; // 1.0 in IEEE binary32
+
+  m &= ieeeMantissa;                     // Keep only mantissa bits (fractional part)
+  m |= ieeeOne;                          // Add fractional part to 1.0
+
+  float  f = uintBitsToFloat( m );       // Range [1:2]
+  return f - 1.0;                        // Range [0:1]
+}
+
+float Random( vec4  v ) 
+{ 
+  return FloatConstruct(Hash(floatBitsToUint(v))); 
+}
+
+// ------------------ RANDOMIZATION CODE END ------------------------------
+
+// Rounds up with the probability of the fractional part, which keeps the expected total
+float StochasticRound(float value, float random)
+{
+  return floor(value + random);
+}
+
+void main()
+{
+  vec4 moments = u_Reset ? vec4(0) : texelFetch(u_MomentsUnit, ivec2(gl_FragCoord.xy), 0);
+  vec4 total = texelFetch(u_SumUnit, ivec2(0), 0);
+  ivec2 size = textureSize(u_MomentsUnit, 0);
+  float budget = u_RayBudget * size.x * size.y;
+  float warmingUp = total.z;
+  float random = Random(vec4(gl_FragCoord.xy, u_Time, 0));
+
+  // Needs to match the classification in reduction.glsl
+  float count;
+  if(moments.z < u_MinSamples)
+  {
+    // Pixels without enough samples for a variance estimate are served first
+    if(warmingUp >= budget)
+      count = random < budget / warmingUp ? 1 : 0;
+    else if(total.y == 0)
+      count = StochasticRound(budget / warmingUp, random); // Nothing else to spend the budget on
+    else
+      count = 1;
+  }
+  else if(moments.w < u_ConvergenceThreshold)
+    count = 0; // Converged
+  else
+  {
+    // The rest of the budget is shared in proportion to the error
+    float remaining = max(budget - warmingUp, 0.0);
+    count = StochasticRound(remaining * moments.w / total.x, random);
+  }
+  // Rays above the cap are not redistributed, so the budget can be underspent
+  samples = min(count, u_MaxSamples);
+}
+
+//vertex
+#version 450 core
+
+layout(location = 0) in vec2 a_Position;
+
+void main()
+{
+  gl_Position = vec4(a_Position, 0.0, 1.0);
+}
@@ -4,12 +4,25 @@
 #define MAX_REFLECTIONS 1
 #define MAX_TRANSPARENCIES 2
 /* #define _COLOR_ONLY */
+/* #define _TRAVERSAL_STATS */ // Needs to match the define in src/main.cpp
+/* #define _ADAPTIVE_SAMPLING */ // Needs to match the define in src/main.cpp
+
+#ifdef _TRAVERSAL_STATS
+// Optional, used to reduce the totals per subgroup before touching the atomics
+#extension GL_KHR_shader_subgroup_basic : enable
+#extension GL_KHR_shader_subgroup_arithmetic : enable
+#extension GL_KHR_shader_subgroup_ballot : enable
+#endif
 
 in vec3 v_Near;
 in vec3 v_Dir;
 in vec3 v_CameraPos;
 
-out vec4 f_Color;
+layout(location = 0) out vec4 f_Color;
+#ifdef _ADAPTIVE_SAMPLING
+// x = samples, y = mean luminance, z = sum of squared differences from the mean
+layout(location = 1) out vec4 f_Samples;
+#endif
 
 uniform sampler2D u_TextureUnit;
 uniform sampler3D u_ChunkTexUnit;
@@ -23,9 +36,48 @@ uniform float u_Time;
 uniform float u_RayNoise;
 uniform float u_ReflectionNoise;
 uniform float u_RefractionNoise;
+#ifdef _ADAPTIVE_SAMPLING
+uniform bool u_AdaptiveSampling = false;
+uniform sampler2D u_SampleUnit;
+#endif
 
 const int c_Materials = 4;
 
+#ifdef _TRAVERSAL_STATS
+// Layers needs to match TraversalStat in src/TraversalStats.h
+const int c_StatSteps = 0;
+const int c_StatShadowSteps = 1;
+const int c_StatRefractions = 2;
+const int c_StatInternalReflectionEscapes = 3;
+
+layout(r32ui, binding = 0) uniform writeonly uimage2DArray u_StatsImage;
+// Set when the driver supports subgroup operations in fragment shaders, see TraversalStats.cpp
+uniform bool u_SubgroupReduction = false;
+
+// Needs to match TraversalTotals in src/TraversalStats.h. The totals are 32-bit and
+// can overflow for large frames with many samples per pixel (adaptive sampling).
+layout(std430, binding = 1) buffer TraversalStatsBuffer
+{
+  uint totalRays;
+  uint totalSteps;
+  uint totalShadowSteps;
+  uint totalRefractions;
+  uint totalInternalReflectionEscapes;
+};
+
+uint statRays = 0;
+uint statSteps = 0;
+uint statShadowSteps = 0;
+uint statRefractions = 0;
+uint statInternalReflectionEscapes = 0;
+
+#define COUNT_STAT(stat) stat++
+// Most pixels never refract, so skip the atomics when there is nothing to add
+#define ADD_TOTAL(total, value) if((value) > 0u) atomicAdd(total, value)
+#else
+#define COUNT_STAT(stat)
+#endif
+
 struct Ray
 {
   vec3 pos;
@@ -89,6 +141,7 @@ Material materials[c_Materials] = {
 #endif
 
 float ambient = 0.3;
+uint sampleIndex = 0u;
 
 int intersectionAxis[3][3] = {{0,2,1}, {1,0,2}, {2,0,1}};
 
@@ -129,12 +182,18 @@ float Random( vec4  v )
   return FloatConstruct(Hash(floatBitsToUint(v))); 
 }
 
+// Mixes the sample index into the hash, so samples within a frame never share a seed
+float Random( vec4 v, uint salt ) 
+{ 
+  return FloatConstruct(Hash(floatBitsToUint(v) ^ uvec4(0u, 0u, 0u, Hash(salt)))); 
+}
+
 vec3 RandomizeDirection(vec3 dir, vec3 pos, float randomness, float seed)
 {
   // Bad solution
-  float dx = Random(vec4(pos + dir + seed, 0 + seed));
-  float dy = Random(vec4(pos + dir + seed, 0.5 + seed));
-  float dz = Random(vec4(pos + dir + seed, 1.0 + seed));
+  float dx = Random(vec4(pos + dir + seed, 0 + seed), sampleIndex);
+  float dy = Random(vec4(pos + dir + seed, 0.5 + seed), sampleIndex);
+  float dz = Random(vec4(pos + dir + seed, 1.0 + seed), sampleIndex);
 
   return normalize(dir + (vec3(dx, dy, dz) - 0.5) * randomness);
 }
@@ -219,6 +278,7 @@ Ray GetRefractionRay(Ray ray, RayIntersection intersection)
   float outRefractivity = GetMaterial(GetVoxel(intersection.collisionPoint + intersection.normal * 0.5)).refractivity;
   float inRefractivity= GetMaterial(GetVoxel(intersection.collisionPoint - intersection.normal * 0.5)).refractivity;
 
+  COUNT_STAT(statRefractions);
   Material material = GetMaterial(intersection.voxel);
   Ray refractionRay;
   refractionRay.voxel = intersection.voxel;
@@ -272,6 +332,7 @@ bool RayMarchShadow(inout Ray ray)
 
   while(rayLength < u_MaxRayLength)
   {
+    COUNT_STAT(statShadowSteps);
     if(!TestCube(currentPos, ray.dir, vec3(u_Size*0.5), vec3(u_Size)))
     {
       return false;
@@ -316,6 +377,7 @@ RayIntersection RayMarch(inout Ray ray)
 
   while(rayLength < u_MaxRayLength)
   {
+    COUNT_STAT(statSteps);
     if(!TestCube(currentPos, ray.dir, vec3(u_Size*0.5), vec3(u_Size)))
     {
       return RayIntersection(0, vec3(0,0,0), 0, vec3(0), vec2(0), false);
@@ -365,6 +427,7 @@ RayIntersection RayMarch(inout Ray ray)
         internalReflection++;
         if(internalReflection > 10)
         {
+          COUNT_STAT(statInternalReflectionEscapes);
           ray.dir = oldDir;
           ray.voxel = 0;
         }
@@ -394,6 +457,7 @@ vec3 GetSkyboxColor(Ray ray, vec3 color)
 
 RayIntersection TraceWithShadow(inout Ray ray, inout vec3 color)
 {
+  COUNT_STAT(statRays);
   RayIntersection intersection = RayMarch(ray);
   if(intersection.found)
   {
@@ -422,7 +486,7 @@ RayIntersection TraceWithShadow(inout Ray ray, inout vec3 color)
   return intersection;
 }
 
-void main()
+vec3 TracePixel()
 {
   vec3 color = vec3(0,0,0);
 
@@ -448,7 +512,82 @@ void main()
       }
     }
   }
-  f_Color = vec4(color, 1.0);
+  return color;
+}
+
+void main()
+{
+#ifdef _ADAPTIVE_SAMPLING
+  // The amount of samples is decided by the allocation pass in sampling.glsl
+  int samples = 1;
+  if(u_AdaptiveSampling)
+    samples = int(texelFetch(u_SampleUnit, ivec2(gl_FragCoord.xy), 0).x);
+
+  vec3 color = vec3(0);
+  float mean = 0;
+  float m2 = 0;
+  for(int i = 0; i < samples; i++)
+  {
+    sampleIndex = uint(i);
+    vec3 sampleColor = TracePixel();
+    color += sampleColor;
+
+    // Clamped to what is displayed, so bright sun and highlight pixels don't eat the budget.
+    // Welford's update to keep the variance accurate in fp32.
+    float luminance = clamp(dot(sampleColor, vec3(0.2126, 0.7152, 0.0722)), 0.0, 1.0);
+    float delta = luminance - mean;
+    mean += delta / (i + 1);
+    m2 += delta * (luminance - mean);
+  }
+  f_Color = vec4(samples > 0 ? color / samples : color, 1.0);
+  f_Samples = vec4(samples, mean, m2, 0);
+#else
+  f_Color = vec4(TracePixel(), 1.0);
+#endif
+
+#ifdef _TRAVERSAL_STATS
+  ivec2 pixel = ivec2(gl_FragCoord.xy);
+  imageStore(u_StatsImage, ivec3(pixel, c_StatSteps), uvec4(statSteps));
+  imageStore(u_StatsImage, ivec3(pixel, c_StatShadowSteps), uvec4(statShadowSteps));
+  imageStore(u_StatsImage, ivec3(pixel, c_StatRefractions), uvec4(statRefractions));
+  imageStore(u_StatsImage, ivec3(pixel, c_StatInternalReflectionEscapes), uvec4(statInternalReflectionEscapes));
+#if defined(GL_KHR_shader_subgroup_arithmetic) && defined(GL_KHR_shader_subgroup_ballot)
+  if(u_SubgroupReduction)
+  {
+    // Helper invocations can take part in subgroup operations, so keep their counts
+    // out of the sums and never let one of them do the write, since it would be discarded
+    if(gl_HelperInvocation)
+    {
+      statRays = 0;
+      statSteps = 0;
+      statShadowSteps = 0;
+      statRefractions = 0;
+      statInternalReflectionEscapes = 0;
+    }
+    statRays = subgroupAdd(statRays);
+    statSteps = subgroupAdd(statSteps);
+    statShadowSteps = subgroupAdd(statShadowSteps);
+    statRefractions = subgroupAdd(statRefractions);
+    statInternalReflectionEscapes = subgroupAdd(statInternalReflectionEscapes);
+    if(gl_SubgroupInvocationID == subgroupBallotFindLSB(subgroupBallot(!gl_HelperInvocation)))
+    {
+      ADD_TOTAL(totalRays, statRays);
+      ADD_TOTAL(totalSteps, statSteps);
+      ADD_TOTAL(totalShadowSteps, statShadowSteps);
+      ADD_TOTAL(totalRefractions, statRefractions);
+      ADD_TOTAL(totalInternalReflectionEscapes, statInternalReflectionEscapes);
+    }
+  }
+  else
+#endif
+  {
+    ADD_TOTAL(totalRays, statRays);
+    ADD_TOTAL(totalSteps, statSteps);
+    ADD_TOTAL(totalShadowSteps, statShadowSteps);
+    ADD_TOTAL(totalRefractions, statRefractions);
+    ADD_TOTAL(totalInternalReflectionEscapes, statInternalReflectionEscapes);
+  }
+#endif
 }
 
 //vertex
@@ -0,0 +1,214 @@
+#include "AdaptiveSampler.h"
+
+#include <Greet.h>
+
+namespace
+{
+  uint CreateTexture(uint internalFormat, uint format, uint width, uint height)
+  {
+    uint texture;
+    GLCall(glGenTextures(1, &texture));
+    GLCall(glBindTexture(GL_TEXTURE_2D, texture));
+    GLCall(glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_FLOAT, nullptr));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    GLCall(glBindTexture(GL_TEXTURE_2D, 0));
+    return texture;
+  }
+
+  uint CreateFrameBuffer(uint attachment0, uint attachment1 = 0)
+  {
+    uint fbo;
+    GLCall(glGenFramebuffers(1, &fbo));
+    GLCall(glBindFramebuffer(GL_FRAMEBUFFER, fbo));
+    GLCall(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, attachment0, 0));
+    if(attachment1)
+    {
+      GLCall(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, attachment1, 0));
+      uint drawBuffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+      GLCall(glDrawBuffers(2, drawBuffers));
+    }
+    GLCall(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    return fbo;
+  }
+
+  void BindTexture(uint unit, uint texture)
+  {
+    GLCall(glActiveTexture(GL_TEXTURE0 + unit));
+    GLCall(glBindTexture(GL_TEXTURE_2D, texture));
+  }
+}
+
+AdaptiveSampler::AdaptiveSampler(uint width, uint height, const Greet::Ref<Greet::VertexArray>& vao)
+  : width{width}, height{height}, vao{vao}
+{
+  reductionShader = Greet::Shader::FromFile("res/shaders/reduction.glsl");
+  allocationShader = Greet::Shader::FromFile("res/shaders/sampling.glsl");
+  accumulationShader = Greet::Shader::FromFile("res/shaders/accumulation.glsl");
+  CreateTargets();
+}
+
+AdaptiveSampler::~AdaptiveSampler()
+{
+  DeleteTargets();
+}
+
+void AdaptiveSampler::CreateTargets()
+{
+  for(int i = 0; i < 2; i++)
+  {
+    historyColors[i] = CreateTexture(GL_RGBA32F, GL_RGBA, width, height);
+    historyMoments[i] = CreateTexture(GL_RGBA32F, GL_RGBA, width, height);
+    historyFbos[i] = CreateFrameBuffer(historyColors[i], historyMoments[i]);
+
+    // Each reduction pass halves the size, rounded up
+    reductionTextures[i] = CreateTexture(GL_RGBA32F, GL_RGBA, (width + 1) / 2, (height + 1) / 2);
+    reductionFbos[i] = CreateFrameBuffer(reductionTextures[i]);
+  }
+
+  traceColor = CreateTexture(GL_RGBA32F, GL_RGBA, width, height);
+  traceSums = CreateTexture(GL_RGBA32F, GL_RGBA, width, height);
+  traceFbo = CreateFrameBuffer(traceColor, traceSums);
+
+  sampleTexture = CreateTexture(GL_R32F, GL_RED, width, height);
+  sampleFbo = CreateFrameBuffer(sampleTexture);
+
+  // Start from an empty history
+  float clearColor[4] = {0, 0, 0, 0};
+  for(int i = 0; i < 2; i++)
+  {
+    GLCall(glBindFramebuffer(GL_FRAMEBUFFER, historyFbos[i]));
+    GLCall(glClearBufferfv(GL_COLOR, 0, clearColor));
+    GLCall(glClearBufferfv(GL_COLOR, 1, clearColor));
+  }
+  GLCall(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+}
+
+void AdaptiveSampler::DeleteTargets()
+{
+  GLCall(glDeleteFramebuffers(2, historyFbos));
+  GLCall(glDeleteFramebuffers(2, reductionFbos));
+  GLCall(glDeleteFramebuffers(1, &traceFbo));
+  GLCall(glDeleteFramebuffers(1, &sampleFbo));
+  GLCall(glDeleteTextures(2, historyColors));
+  GLCall(glDeleteTextures(2, historyMoments));
+  GLCall(glDeleteTextures(2, reductionTextures));
+  GLCall(glDeleteTextures(1, &traceColor));
+  GLCall(glDeleteTextures(1, &traceSums));
+  GLCall(glDeleteTextures(1, &sampleTexture));
+}
+
+void AdaptiveSampler::Resize(uint _width, uint _height)
+{
+  if(width != _width || height != _height)
+  {
+    width = _width;
+    height = _height;
+    DeleteTargets();
+    CreateTargets();
+  }
+}
+
+void AdaptiveSampler::Allocate(const AdaptiveSamplingParams& params)
+{
+  // Sum the error of the last frame. Halving with rounded up sizes covers
+  // every pixel, also for non power of two sizes.
+  reductionShader->Enable();
+  reductionShader->SetUniform1i("u_InputUnit", 0);
+  reductionShader->SetUniform1i("u_MinSamples", params.minSamples);
+  reductionShader->SetUniform1f("u_ConvergenceThreshold", params.convergenceThreshold);
+  reductionShader->SetUniform1i("u_Reset", params.reset);
+  vao->Enable();
+  uint inputWidth = width;
+  uint inputHeight = height;
+  uint input = historyMoments[current];
+  int output = 0;
+  bool classify = true;
+  do
+  {
+    uint outputWidth = (inputWidth + 1) / 2;
+    uint outputHeight = (inputHeight + 1) / 2;
+    Greet::RenderCommand::PushViewportStack({0,0}, Greet::Vec2f{(float)outputWidth, (float)outputHeight}, true);
+    GLCall(glBindFramebuffer(GL_FRAMEBUFFER, reductionFbos[output]));
+    reductionShader->SetUniform1i("u_Classify", classify);
+    reductionShader->SetUniform1i("u_InputWidth", inputWidth);
+    reductionShader->SetUniform1i("u_InputHeight", inputHeight);
+    BindTexture(0, input);
+    vao->Render(Greet::DrawType::TRIANGLES, 6);
+    Greet::RenderCommand::PopViewportStack();
+
+    input = reductionTextures[output];
+    output = 1 - output;
+    inputWidth = outputWidth;
+    inputHeight = outputHeight;
+    classify = false;
+  } while(inputWidth > 1 || inputHeight > 1);
+  sumTexture = input;
+  reductionShader->Disable();
+
+  GLCall(glBindFramebuffer(GL_FRAMEBUFFER, sampleFbo));
+  allocationShader->Enable();
+  allocationShader->SetUniform1i("u_MomentsUnit", 0);
+  allocationShader->SetUniform1i("u_SumUnit", 1);
+  allocationShader->SetUniform1f("u_RayBudget", params.rayBudget);
+  allocationShader->SetUniform1i("u_MaxSamples", params.maxSamples);
+  allocationShader->SetUniform1i("u_MinSamples", params.minSamples);
+  allocationShader->SetUniform1f("u_ConvergenceThreshold", params.convergenceThreshold);
+  allocationShader->SetUniform1i("u_Reset", params.reset);
+  allocationShader->SetUniform1f("u_Time", params.time);
+  BindTexture(0, historyMoments[current]);
+  BindTexture(1, sumTexture);
+  vao->Render(Greet::DrawType::TRIANGLES, 6);
+  vao->Disable();
+  allocationShader->Disable();
+  GLCall(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+}
+
+void AdaptiveSampler::EnableSampleTexture(uint unit) const
+{
+  BindTexture(unit, sampleTexture);
+}
+
+void AdaptiveSampler::EnableTrace() const
+{
+  GLCall(glBindFramebuffer(GL_FRAMEBUFFER, traceFbo));
+}
+
+void AdaptiveSampler::Accumulate(bool reset)
+{
+  uint next = 1 - current;
+  GLCall(glBindFramebuffer(GL_FRAMEBUFFER, historyFbos[next]));
+  accumulationShader->Enable();
+  accumulationShader->SetUniform1i("u_TraceColorUnit", 0);
+  accumulationShader->SetUniform1i("u_TraceSumsUnit", 1);
+  accumulationShader->SetUniform1i("u_HistoryColorUnit", 2);
+  accumulationShader->SetUniform1i("u_HistoryMomentsUnit", 3);
+  accumulationShader->SetUniform1i("u_Reset", reset);
+  BindTexture(0, traceColor);
+  BindTexture(1, traceSums);
+  BindTexture(2, historyColors[current]);
+  BindTexture(3, historyMoments[current]);
+  vao->Enable();
+  vao->Render(Greet::DrawType::TRIANGLES, 6);
+  vao->Disable();
+  accumulationShader->Disable();
+  GLCall(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+  current = next;
+}
+
+void AdaptiveSampler::EnableOutputTexture(uint unit) const
+{
+  BindTexture(unit, historyColors[current]);
+}
+
+void AdaptiveSampler::EnableOutput() const
+{
+  GLCall(glBindFramebuffer(GL_FRAMEBUFFER, historyFbos[current]));
+}
+
+Greet::Ref<AdaptiveSampler> AdaptiveSampler::Create(uint width, uint height, const Greet::Ref<Greet::VertexArray>& vao)
+{
+  return std::shared_ptr<AdaptiveSampler>(new AdaptiveSampler(width, height, vao));
+}
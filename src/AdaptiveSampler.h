@@ -0,0 +1,77 @@
+#pragma once
+
+#include <common/Types.h>
+#include <common/Memory.h>
+
+namespace Greet
+{
+  class Shader;
+  class VertexArray;
+}
+
+struct AdaptiveSamplingParams
+{
+  float rayBudget; // Average amount of rays per pixel and frame
+  int maxSamples;
+  int minSamples;
+  float convergenceThreshold;
+  bool reset;
+  float time;
+};
+
+// Render targets and passes for variance guided adaptive sampling. Everything
+// is kept in float textures, so the accumulated color keeps improving after
+// many samples. Only created when adaptive sampling is enabled.
+class AdaptiveSampler
+{
+  // Ping-ponged history, attachment 0 = mean color, 1 = luminance moments
+  uint historyFbos[2];
+  uint historyColors[2];
+  uint historyMoments[2];
+  uint current = 0;
+
+  // Output of the ray tracing pass, attachment 0 = average color of the samples, 1 = sample sums
+  uint traceFbo;
+  uint traceColor;
+  uint traceSums;
+
+  // Amount of samples to trace for every pixel
+  uint sampleFbo;
+  uint sampleTexture;
+
+  // Used to sum up the moments over the whole frame
+  uint reductionFbos[2];
+  uint reductionTextures[2];
+  uint sumTexture;
+
+  uint width;
+  uint height;
+
+  Greet::Ref<Greet::Shader> reductionShader;
+  Greet::Ref<Greet::Shader> allocationShader;
+  Greet::Ref<Greet::Shader> accumulationShader;
+  Greet::Ref<Greet::VertexArray> vao;
+
+  private:
+    AdaptiveSampler(uint width, uint height, const Greet::Ref<Greet::VertexArray>& vao);
+    void CreateTargets();
+    void DeleteTargets();
+
+  public:
+    virtual ~AdaptiveSampler();
+    void Resize(uint width, uint height);
+
+    // Decides how many samples each pixel gets this frame, within the ray budget
+    void Allocate(const AdaptiveSamplingParams& params);
+    void EnableSampleTexture(uint unit) const;
+
+    // Target of the ray tracing pass
+    void EnableTrace() const;
+
+    // Merges the traced samples into the history
+    void Accumulate(bool reset);
+    void EnableOutputTexture(uint unit) const;
+    void EnableOutput() const;
+
+    static Greet::Ref<AdaptiveSampler> Create(uint width, uint height, const Greet::Ref<Greet::VertexArray>& vao);
+};
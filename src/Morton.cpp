@@ -0,0 +1,35 @@
+#include "Morton.h"
+
+#include <cassert>
+#include <cstddef>
+
+std::vector<byte> Morton::FromLinear(const std::vector<byte>& linearData, uint size)
+{
+  // Part1By2 only keeps 10 bits per axis
+  assert(size <= 1024 && "Morton volumes are limited to 1024^3 voxels");
+  assert(linearData.size() == (std::size_t)size * size * size && "Linear data does not match the volume size");
+
+  uint paddedSize = 1;
+  while(paddedSize < size)
+    paddedSize <<= 1;
+
+  std::vector<byte> mortonData(paddedSize * paddedSize * paddedSize);
+
+  std::vector<uint> partX(size);
+  for(uint x = 0; x < size; x++)
+    partX[x] = Part1By2(x);
+
+  for(uint z = 0; z < size; z++)
+  {
+    for(uint y = 0; y < size; y++)
+    {
+      uint partYZ = (Part1By2(y) << 1) | (Part1By2(z) << 2);
+      const byte* row = linearData.data() + y * size + z * size * size;
+      for(uint x = 0; x < size; x++)
+      {
+        mortonData[partX[x] | partYZ] = row[x];
+      }
+    }
+  }
+  return mortonData;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <common/Types.h>
+
+#include <vector>
+
+// Helpers for storing voxels in Morton (Z-curve) order, which keeps neighbours
+// along all three axes close in memory instead of only along x. Coordinates are
+// limited to 10 bits, ie volumes up to 1024^3.
+class Morton
+{
+  public:
+    // Spreads the lower 10 bits of x so that there are two zero bits between each bit
+    static inline uint Part1By2(uint x)
+    {
+      x &= 0x000003ff;
+      x = (x ^ (x << 16)) & 0xff0000ff;
+      x = (x ^ (x <<  8)) & 0x0300f00f;
+      x = (x ^ (x <<  4)) & 0x030c30c3;
+      x = (x ^ (x <<  2)) & 0x09249249;
+      return x;
+    }
+
+    // Inverse of Part1By2
+    static inline uint Compact1By2(uint x)
+    {
+      x &= 0x09249249;
+      x = (x ^ (x >>  2)) & 0x030c30c3;
+      x = (x ^ (x >>  4)) & 0x0300f00f;
+      x = (x ^ (x >>  8)) & 0xff0000ff;
+      x = (x ^ (x >> 16)) & 0x000003ff;
+      return x;
+    }
+
+    static inline uint Encode(uint x, uint y, uint z)
+    {
+      return Part1By2(x) | (Part1By2(y) << 1) | (Part1By2(z) << 2);
+    }
+
+    static inline void Decode(uint code, uint& x, uint& y, uint& z)
+    {
+      x = Compact1By2(code);
+      y = Compact1By2(code >> 1);
+      z = Compact1By2(code >> 2);
+    }
+
+    // Moves a Morton code one voxel along the given axis without decoding it, by
+    // only adding or subtracting within the bits belonging to that axis
+    static inline uint Increment(uint code, uint axis)
+    {
+      uint mask = 0x09249249u << axis;
+      return (((code | ~mask) + 1) & mask) | (code & ~mask);
+    }
+
+    static inline uint Decrement(uint code, uint axis)
+    {
+      uint mask = 0x09249249u << axis;
+      return (((code & mask) - 1) & mask) | (code & ~mask);
+    }
+
+    // Converts a buffer indexed by x + y * size + z * size * size into Morton order.
+    // The result is padded to the next power of two, since the Z-curve only
+    // covers power of two cubes densely.
+    static std::vector<byte> FromLinear(const std::vector<byte>& linearData, uint size);
+};
@@ -0,0 +1,143 @@
+#include "StorageBenchmark.h"
+
+#include "Morton.h"
+
+#include <logging/Log.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+  struct BenchmarkRay
+  {
+    float pos[3];
+    float dir[3];
+  };
+
+  struct TraversalResult
+  {
+    uint64_t steps = 0;
+    uint64_t hits = 0;
+    double ms = 0;
+  };
+
+  // Both layouts move their index incrementally, so the benchmark measures the
+  // memory layout rather than the cost of computing an index from x, y and z
+  struct LinearLayout
+  {
+    const byte* data;
+    uint strides[3];
+
+    LinearLayout(const byte* data, uint size)
+      : data{data}, strides{1, size, size * size}
+    {}
+
+    uint Index(uint x, uint y, uint z) const { return x * strides[0] + y * strides[1] + z * strides[2]; }
+    uint Step(uint index, int axis, int step) const { return step > 0 ? index + strides[axis] : index - strides[axis]; }
+    byte Fetch(uint index) const { return data[index]; }
+  };
+
+  struct MortonLayout
+  {
+    const byte* data;
+
+    uint Index(uint x, uint y, uint z) const { return Morton::Encode(x, y, z); }
+    uint Step(uint index, int axis, int step) const { return step > 0 ? Morton::Increment(index, axis) : Morton::Decrement(index, axis); }
+    byte Fetch(uint index) const { return data[index]; }
+  };
+
+  // Amanatides & Woo traversal, stops at the first non empty voxel or when leaving the volume
+  template <typename Layout>
+  void Traverse(const Layout& layout, int size, const BenchmarkRay& ray, TraversalResult& result)
+  {
+    int cell[3];
+    int step[3];
+    float tMax[3];
+    float tDelta[3];
+    for(int i = 0; i < 3; i++)
+    {
+      // The distribution can return exactly 1.0 on some standard libraries
+      cell[i] = std::min((int)ray.pos[i], size - 1);
+      step[i] = ray.dir[i] < 0 ? -1 : 1;
+      tDelta[i] = ray.dir[i] != 0 ? std::abs(1.0f / ray.dir[i]) : INFINITY;
+      float nextPlane = step[i] > 0 ? cell[i] + 1 : cell[i];
+      tMax[i] = ray.dir[i] != 0 ? (nextPlane - ray.pos[i]) / ray.dir[i] : INFINITY;
+    }
+
+    uint index = layout.Index(cell[0], cell[1], cell[2]);
+    while(true)
+    {
+      result.steps++;
+      if(layout.Fetch(index) != 0)
+      {
+        result.hits++;
+        return;
+      }
+      int axis = tMax[0] < tMax[1] ? (tMax[0] < tMax[2] ? 0 : 2) : (tMax[1] < tMax[2] ? 1 : 2);
+      cell[axis] += step[axis];
+      if(cell[axis] < 0 || cell[axis] >= size)
+        return;
+      index = layout.Step(index, axis, step[axis]);
+      tMax[axis] += tDelta[axis];
+    }
+  }
+
+  template <typename Layout>
+  TraversalResult Run(const Layout& layout, int size, const std::vector<BenchmarkRay>& rays)
+  {
+    TraversalResult result;
+    auto start = std::chrono::high_resolution_clock::now();
+    for(const BenchmarkRay& ray : rays)
+      Traverse(layout, size, ray, result);
+    auto end = std::chrono::high_resolution_clock::now();
+    result.ms = std::chrono::duration<double, std::milli>(end - start).count();
+    return result;
+  }
+
+  void RunBenchmark(uint size, uint rayCount, float density)
+  {
+    std::mt19937 rng{1337};
+    std::uniform_real_distribution<float> unit{0.0f, 1.0f};
+    std::normal_distribution<float> normal{0.0f, 1.0f};
+
+    std::vector<byte> linear(size * size * size);
+    for(byte& voxel : linear)
+      voxel = unit(rng) < density ? 1 : 0;
+    std::vector<byte> morton = Morton::FromLinear(linear, size);
+
+    std::vector<BenchmarkRay> rays(rayCount);
+    for(BenchmarkRay& ray : rays)
+    {
+      float length = 0;
+      for(int i = 0; i < 3; i++)
+      {
+        ray.pos[i] = unit(rng) * size;
+        ray.dir[i] = normal(rng);
+        length += ray.dir[i] * ray.dir[i];
+      }
+      length = std::sqrt(length);
+      for(int i = 0; i < 3; i++)
+        ray.dir[i] /= length;
+    }
+
+    TraversalResult linearResult = Run(LinearLayout{linear.data(), size}, size, rays);
+    TraversalResult mortonResult = Run(MortonLayout{morton.data()}, size, rays);
+
+    if(linearResult.steps != mortonResult.steps || linearResult.hits != mortonResult.hits)
+      Log::Error("Linear and Morton traversal disagree for size ", size);
+
+    Log::Info("Size ", size, "^3, ", rayCount, " rays, ", linearResult.steps, " steps, ", linearResult.hits, " hits");
+    Log::Info("  Linear: ", linearResult.ms, " ms, ", linearResult.ms * 1e6 / linearResult.steps, " ns/step");
+    Log::Info("  Morton: ", mortonResult.ms, " ms, ", mortonResult.ms * 1e6 / mortonResult.steps, " ns/step");
+  }
+}
+
+void RunStorageBenchmark()
+{
+  RunBenchmark(128, 1 << 20, 0.002f);
+  RunBenchmark(512, 1 << 18, 0.0005f);
+}
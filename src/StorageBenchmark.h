@@ -0,0 +1,7 @@
+#pragma once
+
+// Compares random direction DDA traversal on the CPU through a linear
+// (x + y * size + z * size * size) voxel buffer and a Morton ordered one.
+// Runs without an OpenGL context, see _STORAGE_BENCHMARK in main.cpp.
+// Morton did not beat linear for random directions, see README.md.
+void RunStorageBenchmark();
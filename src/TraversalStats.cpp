@@ -0,0 +1,112 @@
+#include "TraversalStats.h"
+
+#include <internal/GreetGL.h>
+
+#include <cstring>
+
+// From GL_KHR_shader_subgroup, which older headers might not define
+#ifndef GL_SUBGROUP_SUPPORTED_STAGES_KHR
+#define GL_SUBGROUP_SUPPORTED_STAGES_KHR 0x9533
+#define GL_SUBGROUP_SUPPORTED_FEATURES_KHR 0x9534
+#define GL_SUBGROUP_FEATURE_ARITHMETIC_BIT_KHR 0x00000004
+#define GL_SUBGROUP_FEATURE_BALLOT_BIT_KHR 0x00000008
+#endif
+
+TraversalStats::TraversalStats(uint width, uint height)
+  : width{width}, height{height}, subgroupReduction{SupportsSubgroupReduction()}
+{
+  CreateTexture();
+  GLCall(glGenBuffers(1, &ssbo));
+  GLCall(glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo));
+  GLCall(glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(TraversalTotals), nullptr, GL_DYNAMIC_READ));
+  GLCall(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+}
+
+TraversalStats::~TraversalStats()
+{
+  GLCall(glDeleteTextures(1, &texture));
+  GLCall(glDeleteBuffers(1, &ssbo));
+}
+
+bool TraversalStats::SupportsSubgroupReduction()
+{
+  // The shader compiling with the extension doesn't mean that the fragment stage supports it
+  int extensions = 0;
+  GLCall(glGetIntegerv(GL_NUM_EXTENSIONS, &extensions));
+  bool found = false;
+  for(int i = 0; i < extensions && !found; i++)
+    found = strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_KHR_shader_subgroup") == 0;
+  if(!found)
+    return false;
+
+  int stages = 0;
+  int features = 0;
+  GLCall(glGetIntegerv(GL_SUBGROUP_SUPPORTED_STAGES_KHR, &stages));
+  GLCall(glGetIntegerv(GL_SUBGROUP_SUPPORTED_FEATURES_KHR, &features));
+  int requiredFeatures = GL_SUBGROUP_FEATURE_ARITHMETIC_BIT_KHR | GL_SUBGROUP_FEATURE_BALLOT_BIT_KHR;
+  return (stages & GL_FRAGMENT_SHADER_BIT) && (features & requiredFeatures) == requiredFeatures;
+}
+
+void TraversalStats::CreateTexture()
+{
+  GLCall(glGenTextures(1, &texture));
+  GLCall(glBindTexture(GL_TEXTURE_2D_ARRAY, texture));
+  GLCall(glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R32UI, width, height, (uint)TraversalStat::Count));
+  GLCall(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+  GLCall(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+  GLCall(glBindTexture(GL_TEXTURE_2D_ARRAY, 0));
+}
+
+void TraversalStats::Resize(uint _width, uint _height)
+{
+  if(width != _width || height != _height)
+  {
+    width = _width;
+    height = _height;
+    // Storage is immutable, so the texture has to be recreated
+    GLCall(glDeleteTextures(1, &texture));
+    CreateTexture();
+  }
+}
+
+void TraversalStats::Enable() const
+{
+  GLCall(glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo));
+  GLCall(glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr));
+  GLCall(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+  GLCall(glBindImageTexture(0, texture, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_R32UI));
+  GLCall(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, ssbo));
+}
+
+void TraversalStats::Disable()
+{
+  GLCall(glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT));
+  GLCall(glBindImageTexture(0, 0, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_R32UI));
+  GLCall(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0));
+}
+
+void TraversalStats::EnableTexture(uint unit) const
+{
+  GLCall(glActiveTexture(GL_TEXTURE0 + unit));
+  GLCall(glBindTexture(GL_TEXTURE_2D_ARRAY, texture));
+}
+
+void TraversalStats::DisableTexture(uint unit)
+{
+  GLCall(glActiveTexture(GL_TEXTURE0 + unit));
+  GLCall(glBindTexture(GL_TEXTURE_2D_ARRAY, 0));
+}
+
+TraversalTotals TraversalStats::GetTotals() const
+{
+  TraversalTotals totals;
+  GLCall(glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo));
+  GLCall(glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(TraversalTotals), &totals));
+  GLCall(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+  return totals;
+}
+
+Greet::Ref<TraversalStats> TraversalStats::Create(uint width, uint height)
+{
+  return std::shared_ptr<TraversalStats>(new TraversalStats(width, height));
+}
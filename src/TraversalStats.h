@@ -0,0 +1,59 @@
+#pragma once
+
+#include <common/Types.h>
+#include <common/Memory.h>
+
+// Layers of the per pixel stats image, needs to match the order in res/shaders/voxel.glsl
+enum class TraversalStat
+{
+  Steps, ShadowSteps, Refractions, InternalReflectionEscapes, Count
+};
+
+// 32-bit totals can overflow for large frames with many samples per pixel
+struct TraversalTotals
+{
+  uint rays;
+  uint steps;
+  uint shadowSteps;
+  uint refractions;
+  uint internalReflectionEscapes;
+};
+
+// Counters written by voxel.glsl when compiled with _TRAVERSAL_STATS. Per pixel
+// counters are stored in an R32UI array texture and the totals of a frame in a
+// shader storage buffer.
+class TraversalStats
+{
+  uint texture;
+  uint ssbo;
+  uint width;
+  uint height;
+  bool subgroupReduction;
+
+  private:
+    TraversalStats(uint width, uint height);
+
+  public:
+    virtual ~TraversalStats();
+    void Resize(uint width, uint height);
+
+    uint GetWidth() const { return width; }
+    uint GetHeight() const { return height; }
+    // Whether the totals can be reduced per subgroup in the fragment shader
+    bool HasSubgroupReduction() const { return subgroupReduction; }
+
+    // Resets the totals and binds the counters for the ray tracing shader
+    void Enable() const;
+    static void Disable();
+
+    // Binds the per pixel counters as a usampler2DArray
+    void EnableTexture(uint unit) const;
+    static void DisableTexture(uint unit);
+    TraversalTotals GetTotals() const;
+
+    static Greet::Ref<TraversalStats> Create(uint width, uint height);
+
+  private:
+    void CreateTexture();
+    static bool SupportsSubgroupReduction();
+};
@@ -1,13 +1,20 @@
 #include <Greet.h>
 
+#include "AdaptiveSampler.h"
 #include "FrameBuffer.h"
+#include "StorageBenchmark.h"
+#include "TraversalStats.h"
 
+#include <fstream>
 #include <thread>
 
 /* #define _GLASS_CUBE */
 #define _TERRAIN
 /* #define _REFRACTION */
 /* #define _HIGH_PERFORMANCE */
+/* #define _STORAGE_BENCHMARK */
+/* #define _TRAVERSAL_STATS */ // Needs to match the define in res/shaders/voxel.glsl
+/* #define _ADAPTIVE_SAMPLING */ // Needs to match the define in res/shaders/voxel.glsl
 
 using namespace Greet;
 
@@ -130,12 +137,21 @@ class AppScene : public Scene
     Ref<Shader> rayTracingShader;
     Ref<Shader> filterShader;
     Ref<Shader> passthroughShader;
+#ifdef _TRAVERSAL_STATS
+    Ref<Shader> heatmapShader;
+    Ref<TraversalStats> traversalStats;
+    TraversalTotals traversalTotals{};
+    int heatmapMode = 0; // 0 shows the scene, otherwise the TraversalStat layer + 1
+    std::ofstream statsCsv;
+    uint statsFrame = 0;
+#endif
     Ref<VertexArray> vao;
     Ref<VertexBuffer> vbo;
     Ref<Buffer> ibo;
     Ref<FrameBuffer> fbo1;
     Ref<FrameBuffer> fbo2;
     Ref<FrameBuffer> fbo3;
+    Ref<AdaptiveSampler> adaptiveSampler; // Created the first time adaptive sampling is enabled
 
     FrameBuffer* lastFrameBuffer = nullptr;
     FrameBuffer* currentFrameBuffer = nullptr;
@@ -157,6 +173,13 @@ class AppScene : public Scene
     float reflectionNoise = 0.0;
     float refractionNoise = 0.0;
 
+    bool adaptiveSampling = false;
+    bool resetSamples = true;
+    float rayBudget = 1.0;
+    int maxSamples = 8;
+    int minSamples = 4;
+    float convergenceThreshold = 1e-5;
+
     AppScene()
       : cam{Mat4::Perspective(RenderCommand::GetViewportAspect(), 90, 0.01,100.0f)}, camController{cam}
     {
@@ -167,6 +190,9 @@ class AppScene : public Scene
       currentFrameBuffer = fbo1.get();
       lastFrameBuffer = fbo2.get();
       rayTraceFrameBuffer = fbo3.get();
+#ifdef _TRAVERSAL_STATS
+      traversalStats = TraversalStats::Create(1440, 810);
+#endif
 
       cam.SetPosition({-3.45, 2.17, 3.53});
       cam.SetRotation({-33.00, -48.00, 0.00});
@@ -213,6 +239,9 @@ class AppScene : public Scene
       rayTracingShader = Shader::FromFile("res/shaders/voxel.glsl");
       filterShader = Shader::FromFile("res/shaders/temporal.glsl");
       passthroughShader  = Shader::FromFile("res/shaders/passthrough.glsl");
+#ifdef _TRAVERSAL_STATS
+      heatmapShader = Shader::FromFile("res/shaders/heatmap.glsl");
+#endif
       uint tex;
       GLCall(glGenTextures(1, &tex));
       std::vector<byte> data(size * size * size);
@@ -319,12 +348,26 @@ class AppScene : public Scene
       texture3D.reset(new uint{tex});
     }
     inline static int fps = 0;
+    inline static float frameTime = 0;
 
     virtual void Render() const override
     {
       RenderCommand::PushViewportStack({0,0}, rayTraceFrameBuffer->GetSize(), true);
-      rayTraceFrameBuffer->Enable();
-      rayTraceFrameBuffer->Clear();
+      static float i = 0;
+      i++;
+
+      if(adaptiveSampling)
+      {
+        // Sample allocation
+        adaptiveSampler->Allocate({rayBudget, maxSamples, minSamples, convergenceThreshold, resetSamples, i});
+        adaptiveSampler->EnableTrace();
+        adaptiveSampler->EnableSampleTexture(2);
+      }
+      else
+      {
+        rayTraceFrameBuffer->Enable();
+        rayTraceFrameBuffer->Clear();
+      }
       TextureManager::LoadTexture2D("res/textures/stone.meta")->Enable(0);
       atlas->Enable(0);
       glActiveTexture(GL_TEXTURE1);
@@ -340,17 +383,26 @@ class AppScene : public Scene
       rayTracingShader->SetUniform1f("u_RayNoise", rayNoise);
       rayTracingShader->SetUniform1f("u_ReflectionNoise", reflectionNoise);
       rayTracingShader->SetUniform1f("u_RefractionNoise", refractionNoise);
-      static float i = 0;
-      i++;
+#ifdef _ADAPTIVE_SAMPLING
+      rayTracingShader->SetUniform1i("u_AdaptiveSampling", adaptiveSampling);
+      rayTracingShader->SetUniform1i("u_SampleUnit", 2);
+#endif
       rayTracingShader->SetUniform1f("u_Time", i);
       Vec2f dir = Vec2f{1.0f,0.0f};
       dir.Rotate(timeOfDay * M_PI * 2 / dayTime);
       rayTracingShader->SetUniform3f("u_SunDir", Vec3<float>{dir.y, dir.x, 0.2}.Normalize());
+#ifdef _TRAVERSAL_STATS
+      rayTracingShader->SetUniform1i("u_SubgroupReduction", traversalStats->HasSubgroupReduction());
+      traversalStats->Enable();
+#endif
       vao->Enable();
       glBeginQuery(GL_TIME_ELAPSED, 1);
       vao->Render(DrawType::TRIANGLES, 6);
       glEndQuery(GL_TIME_ELAPSED);
       vao->Disable();
+#ifdef _TRAVERSAL_STATS
+      TraversalStats::Disable();
+#endif
       rayTracingShader->Disable();
       GLuint64 result;
       glGetQueryObjectui64v(1, GL_QUERY_RESULT, &result);
@@ -358,28 +410,60 @@ class AppScene : public Scene
       if(ms > 1000)
         abort();
       fps = 1000 / ms;
-      rayTraceFrameBuffer->Disable();
-
-      // Filter
-      currentFrameBuffer->Enable();
-      currentFrameBuffer->Clear();
-      filterShader->Enable();
-      filterShader->SetUniform1i("u_TextureUnitNew", 0);
-      filterShader->SetUniform1i("u_TextureUnitOld", 1);
-      filterShader->SetUniform1f("u_Alpha", temporalAlpha);
-      filterShader->SetUniform1i("u_Samples", temporalSamples);
-      rayTraceFrameBuffer->GetTexture()->Enable(0);
-      lastFrameBuffer->GetTexture()->Enable(1);
-      vao->Enable();
-      vao->Render(DrawType::TRIANGLES, 6);
-      vao->Disable();
-      currentFrameBuffer->Disable();
+      frameTime = ms;
+      FrameBuffer::Disable();
+
+      if(adaptiveSampling)
+      {
+        // Accumulate, replaces the temporal filter
+        adaptiveSampler->Accumulate(resetSamples);
+      }
+      else
+      {
+        // Filter
+        currentFrameBuffer->Enable();
+        currentFrameBuffer->Clear();
+        filterShader->Enable();
+        filterShader->SetUniform1i("u_TextureUnitNew", 0);
+        filterShader->SetUniform1i("u_TextureUnitOld", 1);
+        filterShader->SetUniform1f("u_Alpha", temporalAlpha);
+        filterShader->SetUniform1i("u_Samples", temporalSamples);
+        rayTraceFrameBuffer->GetTexture()->Enable(0);
+        lastFrameBuffer->GetTexture()->Enable(1);
+        vao->Enable();
+        vao->Render(DrawType::TRIANGLES, 6);
+        vao->Disable();
+        currentFrameBuffer->Disable();
+      }
       RenderCommand::PopViewportStack();
 
+#ifdef _TRAVERSAL_STATS
+      if(heatmapMode > 0)
+      {
+        // Scale the heatmap after the average of the last frame
+        uint counters[] = {traversalTotals.steps, traversalTotals.shadowSteps, traversalTotals.refractions, traversalTotals.internalReflectionEscapes};
+        float average = counters[heatmapMode - 1] / (float)(traversalStats->GetWidth() * traversalStats->GetHeight());
+        heatmapShader->Enable();
+        heatmapShader->SetUniform1i("u_StatsUnit", 0);
+        heatmapShader->SetUniform1i("u_Layer", heatmapMode - 1);
+        heatmapShader->SetUniform1f("u_MaxValue", std::max(4 * average, 1.0f));
+        traversalStats->EnableTexture(0);
+        vao->Enable();
+        vao->Render(DrawType::TRIANGLES, 6);
+        vao->Disable();
+        TraversalStats::DisableTexture(0);
+        heatmapShader->Disable();
+        return;
+      }
+#endif
+
       // Passthrough
       passthroughShader->Enable();
       passthroughShader->SetUniform1i("u_TextureUnit", 0);
-      currentFrameBuffer->GetTexture()->Enable(0);
+      if(adaptiveSampling)
+        adaptiveSampler->EnableOutputTexture(0);
+      else
+        currentFrameBuffer->GetTexture()->Enable(0);
       vao->Enable();
       vao->Render(DrawType::TRIANGLES, 6);
       vao->Disable();
@@ -390,6 +474,17 @@ class AppScene : public Scene
       // Swap buffers
       std::swap(lastFrameBuffer, currentFrameBuffer);
       temporalSamples++;
+      resetSamples = false;
+#ifdef _TRAVERSAL_STATS
+      // Reading back the totals stalls the pipeline, so only do it when they are used
+      if(heatmapMode > 0 || statsCsv.is_open())
+        traversalTotals = traversalStats->GetTotals();
+      if(statsCsv.is_open())
+      {
+        statsCsv << statsFrame++ << "," << frameTime << "," << traversalTotals.rays << "," << traversalTotals.steps << ","
+          << traversalTotals.shadowSteps << "," << traversalTotals.refractions << "," << traversalTotals.internalReflectionEscapes << "\n";
+      }
+#endif
     }
 
     virtual void Update(float timeElapsed) override
@@ -399,8 +494,13 @@ class AppScene : public Scene
         timeOfDay += timeElapsed;
         while(timeOfDay > dayTime)
           timeOfDay -= dayTime;
+        resetSamples = true;
       }
+      Vec3<float> position = cam.GetPosition();
+      Vec3<float> rotation = cam.GetRotation();
       camController.Update(timeElapsed);
+      if(cam.GetPosition() != position || cam.GetRotation() != rotation)
+        resetSamples = true;
     }
 
     void OnEvent(Event& event) override
@@ -413,24 +513,65 @@ class AppScene : public Scene
         {
           cam.SetPosition({-3.45, 2.17, 3.53});
           cam.SetRotation({-33.00, -48.00, 0.00});
+          resetSamples = true;
         }
         else if(e.GetButton() == GREET_KEY_F)
         {
           Log::Info("Clear Framebuffer");
           std::swap(lastFrameBuffer, rayTraceFrameBuffer);
           temporalSamples = 1;
+          resetSamples = true;
         }
         else if(e.GetButton() == GREET_KEY_F1)
         {
 
-          lastFrameBuffer->Enable();
+          if(adaptiveSampling)
+            adaptiveSampler->EnableOutput();
+          else
+            lastFrameBuffer->Enable();
           Utils::Screenshot(lastFrameBuffer->GetWidth(), lastFrameBuffer->GetHeight());
-          lastFrameBuffer->Disable();
+          FrameBuffer::Disable();
         }
+#ifdef _TRAVERSAL_STATS
+        else if(e.GetButton() == GREET_KEY_H)
+        {
+          const char* names[] = {"Off", "Steps", "Shadow steps", "Refractions", "Internal reflection escapes"};
+          heatmapMode = (heatmapMode + 1) % ((int)TraversalStat::Count + 1);
+          Log::Info("Heatmap: ", names[heatmapMode]);
+        }
+        else if(e.GetButton() == GREET_KEY_F2)
+        {
+          if(statsCsv.is_open())
+          {
+            Log::Info("Stop recording traversal stats");
+            statsCsv.close();
+          }
+          else
+          {
+            Log::Info("Recording traversal stats to traversal_stats.csv");
+            statsCsv.open("traversal_stats.csv");
+            statsCsv << "frame,ms,rays,steps,shadowSteps,refractions,internalReflectionEscapes\n";
+            statsFrame = 0;
+          }
+        }
+#endif
       }
 
     }
 
+    void ToggleAdaptiveSampling()
+    {
+#ifndef _ADAPTIVE_SAMPLING
+      Log::Error("Adaptive sampling requires _ADAPTIVE_SAMPLING to be defined in src/main.cpp and res/shaders/voxel.glsl");
+      return;
+#endif
+      adaptiveSampling = !adaptiveSampling;
+      if(adaptiveSampling && !adaptiveSampler)
+        adaptiveSampler = AdaptiveSampler::Create(rayTraceFrameBuffer->GetWidth(), rayTraceFrameBuffer->GetHeight(), vao);
+      resetSamples = true;
+      Log::Info("Adaptive sampling: ", adaptiveSampling);
+    }
+
     void ViewportResize(ViewportResizeEvent& event) override
     {
       cam.SetProjectionMatrix(Mat4::Perspective(event.GetWidth() / event.GetHeight(), 90, 0.01f, 100.0f));
@@ -448,6 +589,12 @@ class AppScene : public Scene
       fbo3->Enable();
       fbo3->Resize(width, height);
       FrameBuffer::Disable();
+      if(adaptiveSampler)
+        adaptiveSampler->Resize(width, height);
+      resetSamples = true;
+#ifdef _TRAVERSAL_STATS
+      traversalStats->Resize(width, height);
+#endif
     }
 };
 
@@ -498,6 +645,11 @@ class Application : public App
           Log::Error("Couldn't find MakeDay button");
         else
           button->SetOnClickCallback(std::bind(&Application::OnMakeDayPress, std::ref(*this), _1));
+        button = frame->GetComponentByName<Button>("ToggleAdaptiveSampling");
+        if (!button)
+          Log::Error("Couldn't find ToggleAdaptiveSampling button");
+        else
+          button->SetOnClickCallback(std::bind(&Application::OnAdaptiveSamplingPress, std::ref(*this), _1));
         daySlider = frame->GetComponentByName<Slider>("TimeSlider");
         if (!daySlider)
           Log::Error("Couldn't find TimeSlider");
@@ -523,6 +675,11 @@ class Application : public App
           Log::Error("Couldn't find RefractionNoiseSlider");
         else
           slider ->SetOnValueChangeCallback(std::bind(&Application::ChangeRefractionNoise, std::ref(*this), _1, _2, _3));
+        slider = frame->GetComponentByName<Slider>("RayBudgetSlider");
+        if (!slider )
+          Log::Error("Couldn't find RayBudgetSlider");
+        else
+          slider ->SetOnValueChangeCallback(std::bind(&Application::ChangeRayBudget, std::ref(*this), _1, _2, _3));
       }
       else
       {
@@ -575,10 +732,19 @@ class Application : public App
     void OnMakeDayPress(Component* button)
     {
       appScene->timeOfDay = 0.9 * appScene->dayTime;
+      appScene->resetSamples = true;
+    }
+
+    void OnAdaptiveSamplingPress(Component* button)
+    {
+      appScene->ToggleAdaptiveSampling();
     }
 
     void ChangeTimeOfDay(Component* slider, float oldValue, float newValue)
     {
+      // The slider is also updated every frame, so only reset when the time actually changed
+      if(appScene->timeOfDay != newValue * appScene->dayTime)
+        appScene->resetSamples = true;
       appScene->timeOfDay = newValue * appScene->dayTime;
     }
 
@@ -590,24 +756,37 @@ class Application : public App
     void ChangeRayNoise(Component* slider, float oldValue, float newValue)
     {
       appScene->rayNoise = newValue;
+      appScene->resetSamples = true;
       Log::Info("Ray: ", newValue);
     }
 
     void ChangeReflectionNoise(Component* slider, float oldValue, float newValue)
     {
       appScene->reflectionNoise = newValue;
+      appScene->resetSamples = true;
       Log::Info("Reflection: ", newValue);
     }
 
     void ChangeRefractionNoise(Component* slider, float oldValue, float newValue)
     {
       appScene->refractionNoise = newValue;
+      appScene->resetSamples = true;
       Log::Info("Refraction: ", newValue);
     }
+
+    void ChangeRayBudget(Component* slider, float oldValue, float newValue)
+    {
+      appScene->rayBudget = newValue;
+      Log::Info("Ray budget: ", newValue);
+    }
 };
 
 int main()
 {
+#ifdef _STORAGE_BENCHMARK
+  RunStorageBenchmark();
+  return 0;
+#endif
   Application app;
   app.Start();
   return 0;